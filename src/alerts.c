@@ -0,0 +1,249 @@
+/*
+ * Alert and trigger engine
+ */
+
+#include "alerts.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static const char *alert_names[] = {
+    [ALERT_CLIP] = "clip",
+    [ALERT_SILENCE] = "silence",
+    [ALERT_OVER] = "over",
+};
+
+// Used for whatever the user leaves out of a rule spec
+static const struct alert_rule alert_defaults[] = {
+    [ALERT_CLIP]    = { .type = ALERT_CLIP,    .threshold_db = -0.1f, .hold_seconds = 0.0, .hysteresis_db = 1.0f },
+    [ALERT_SILENCE] = { .type = ALERT_SILENCE, .threshold_db = -50.0f, .hold_seconds = 5.0, .hysteresis_db = 3.0f },
+    [ALERT_OVER]    = { .type = ALERT_OVER,    .threshold_db = -6.0f, .hold_seconds = 3.0, .hysteresis_db = 3.0f },
+};
+
+/*
+ * Parses a rule with the form TYPE[:DB[:SECONDS[:HYSTERESIS]]] (e.g. silence:-45:10)
+ * and adds it to the engine. Returns 0 on success and -1 if the spec is invalid.
+ */
+int alerts_add_rule(struct alert_engine *alerts, const char *spec)
+{
+    if (alerts->n_rules >= ALERT_MAX_RULES) {
+        return -1;
+    }
+
+    size_t name_length = strcspn(spec, ":");
+    int type = -1;
+    for (int i = 0; i < (int)(sizeof(alert_names) / sizeof(alert_names[0])); i++) {
+        if (strlen(alert_names[i]) == name_length && strncmp(spec, alert_names[i], name_length) == 0) {
+            type = i;
+            break;
+        }
+    }
+
+    if (type < 0) {
+        return -1;
+    }
+
+    struct alert_rule rule = alert_defaults[type];
+    double values[3] = { rule.threshold_db, rule.hold_seconds, rule.hysteresis_db };
+
+    // Read the optional fields in order
+    const char *p = spec + name_length;
+    for (int i = 0; i < 3 && *p == ':'; i++) {
+        char *end;
+        values[i] = strtod(p + 1, &end);
+        if (end == p + 1) {
+            return -1;
+        }
+        p = end;
+    }
+
+    if (*p != '\0' || values[1] < 0.0 || values[2] < 0.0) {
+        return -1;
+    }
+
+    rule.threshold_db = (float)values[0];
+    rule.hold_seconds = values[1];
+    rule.hysteresis_db = (float)values[2];
+
+    alerts->rules[alerts->n_rules++] = rule;
+    return 0;
+}
+
+/*
+ * Opens the file events get appended to, "-" means stdout.
+ */
+int alerts_open_log(struct alert_engine *alerts, const char *path)
+{
+    if (strcmp(path, "-") == 0) {
+        alerts->log = stdout;
+        return 0;
+    }
+
+    alerts->log = fopen(path, "a");
+    return alerts->log == NULL ? -1 : 0;
+}
+
+static long long realtime_in_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Called from the audio thread. It never blocks: if the queue is full the
+ * event is counted as dropped and reported on the next flush.
+ */
+static void push_event(struct alert_engine *alerts, int rule, int channel, bool active, float level_db)
+{
+    unsigned int head = alerts->head;
+    unsigned int tail = __atomic_load_n(&alerts->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= ALERT_QUEUE_SIZE) {
+        __atomic_fetch_add(&alerts->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct alert_event *event = &alerts->queue[head & (ALERT_QUEUE_SIZE - 1)];
+    event->timestamp_ns = realtime_in_ns();
+    event->rule = rule;
+    event->channel = channel;
+    event->active = active;
+    event->level_db = level_db;
+
+    __atomic_store_n(&alerts->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Evaluates every rule against the peak of one channel for the current block.
+ * A rule fires once the condition has held for hold_seconds, and it is only
+ * released after the level moves hysteresis_db back past the threshold, so a
+ * level hovering around the threshold doesn't flood the log.
+ */
+void alerts_process(struct alert_engine *alerts, int channel, float level_db, double block_seconds)
+{
+    if (channel < 0 || channel >= ALERT_MAX_CHANNELS) {
+        return;
+    }
+
+    for (int i = 0; i < alerts->n_rules; i++) {
+        struct alert_rule *rule = &alerts->rules[i];
+        bool triggered, released;
+
+        if (rule->type == ALERT_SILENCE) {
+            triggered = level_db <= rule->threshold_db;
+            released = level_db > rule->threshold_db + rule->hysteresis_db;
+        }
+        else {
+            triggered = level_db >= rule->threshold_db;
+            released = level_db < rule->threshold_db - rule->hysteresis_db;
+        }
+
+        if (!rule->active[channel]) {
+            if (!triggered) {
+                rule->held[channel] = 0.0;
+                continue;
+            }
+
+            rule->held[channel] += block_seconds;
+            if (rule->held[channel] >= rule->hold_seconds) {
+                rule->active[channel] = true;
+                push_event(alerts, i, channel, true, level_db);
+            }
+        }
+        else if (released) {
+            rule->active[channel] = false;
+            rule->held[channel] = 0.0;
+            push_event(alerts, i, channel, false, level_db);
+        }
+    }
+}
+
+static void write_event(struct alert_engine *alerts, const struct alert_event *event)
+{
+    char time_str[32];
+    time_t seconds = (time_t)(event->timestamp_ns / 1000000000LL);
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm);
+
+    fprintf(alerts->log, "%s.%03lld %s %s channel=%d level=%.1fdB\n",
+            time_str,
+            (event->timestamp_ns / 1000000LL) % 1000,
+            alert_names[alerts->rules[event->rule].type],
+            event->active ? "start" : "end",
+            event->channel,
+            event->level_db);
+}
+
+/*
+ * Runs the hook through the shell without waiting for it. The event is passed
+ * as positional parameters: $1 = type, $2 = start/end, $3 = channel, $4 = level.
+ */
+static void run_hook(struct alert_engine *alerts, const struct alert_event *event)
+{
+    char channel[16], level[16];
+    snprintf(channel, sizeof(channel), "%d", event->channel);
+    snprintf(level, sizeof(level), "%.1f", event->level_db);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", alerts->hook, "vumz",
+              alert_names[alerts->rules[event->rule].type],
+              event->active ? "start" : "end",
+              channel, level, (char *)NULL);
+        _exit(127);
+    }
+    else if (pid < 0 && alerts->log != NULL) {
+        fprintf(alerts->log, "Error running alert hook\n");
+    }
+}
+
+/*
+ * Drains the event queue. This is meant to be called from the main loop so
+ * that file writes and forks never happen on the audio thread.
+ */
+void alerts_flush(struct alert_engine *alerts)
+{
+    unsigned int tail = alerts->tail;
+    unsigned int head = __atomic_load_n(&alerts->head, __ATOMIC_ACQUIRE);
+    unsigned int dropped = __atomic_exchange_n(&alerts->dropped, 0, __ATOMIC_RELAXED);
+
+    while (tail != head) {
+        const struct alert_event *event = &alerts->queue[tail & (ALERT_QUEUE_SIZE - 1)];
+
+        if (alerts->log != NULL) {
+            write_event(alerts, event);
+        }
+        if (alerts->hook != NULL) {
+            run_hook(alerts, event);
+        }
+
+        tail++;
+        __atomic_store_n(&alerts->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (dropped > 0 && alerts->log != NULL) {
+        fprintf(alerts->log, "%u alert events dropped\n", dropped);
+    }
+
+    if (alerts->log != NULL) {
+        fflush(alerts->log);
+    }
+
+    // Reap finished hooks so they don't stay around as zombies
+    while (waitpid(-1, NULL, WNOHANG) > 0);
+}
+
+void alerts_close(struct alert_engine *alerts)
+{
+    alerts_flush(alerts);
+
+    if (alerts->log != NULL && alerts->log != stdout) {
+        fclose(alerts->log);
+    }
+    alerts->log = NULL;
+}
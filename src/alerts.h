@@ -0,0 +1,63 @@
+#ifndef ALERTS_H
+#define ALERTS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define ALERT_MAX_RULES 16
+#define ALERT_MAX_CHANNELS 8
+#define ALERT_QUEUE_SIZE 256 // Must be a power of two
+
+enum alert_type {
+    ALERT_CLIP,     // Block peak at or above the threshold
+    ALERT_SILENCE,  // Block peak below the threshold for a while
+    ALERT_OVER,     // Block peak above the threshold for a while
+};
+
+/*
+ * A single trigger rule. The state kept for each channel is just a flag and
+ * a hold timer, so evaluating a rule costs the same no matter how long the
+ * condition has been going on.
+ */
+struct alert_rule {
+    enum alert_type type;
+    float threshold_db;     // Level that arms the rule
+    float hysteresis_db;    // How far past the threshold the level must go back to release it
+    double hold_seconds;    // How long the condition must hold before the rule fires
+    bool active[ALERT_MAX_CHANNELS];    // Whether the rule is currently firing
+    double held[ALERT_MAX_CHANNELS];    // Seconds the condition has been holding
+};
+
+struct alert_event {
+    long long timestamp_ns; // Wall clock time of the block that fired the event
+    int rule;               // Index into alert_engine.rules
+    int channel;
+    bool active;            // true when the condition starts, false when it ends
+    float level_db;         // Block peak that caused the transition
+};
+
+/*
+ * Holds the rules and a single producer/single consumer queue of events.
+ * The audio thread only evaluates rules and pushes events into the queue,
+ * all the writing and hook spawning is done by whoever calls alerts_flush().
+ */
+struct alert_engine {
+    struct alert_rule rules[ALERT_MAX_RULES];
+    int n_rules;
+
+    struct alert_event queue[ALERT_QUEUE_SIZE];
+    unsigned int head;      // Only written by the audio thread
+    unsigned int tail;      // Only written by the flushing thread
+    unsigned int dropped;   // Events lost because the queue was full
+
+    FILE *log;              // Where events are written, NULL to disable
+    const char *hook;       // Shell command run for every event, NULL to disable
+};
+
+int alerts_add_rule(struct alert_engine *alerts, const char *spec);
+int alerts_open_log(struct alert_engine *alerts, const char *path);
+void alerts_process(struct alert_engine *alerts, int channel, float level_db, double block_seconds);
+void alerts_flush(struct alert_engine *alerts);
+void alerts_close(struct alert_engine *alerts);
+
+#endif // ALERTS_H
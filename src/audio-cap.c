@@ -4,6 +4,7 @@
 
 #include "audio-cap.h"
 #include <math.h>
+#include <limits.h>
 
 void apply_smoothing(float* channel_dbs, struct audio_data* audio, int buffer_index); 
 
@@ -44,6 +45,17 @@ static void on_process(void *userdata) {
     // Write to input buffer
     struct audio_data* audio = (struct audio_data*)(data->audio); // Cast the audio_data of pipewire_data
     double gravity_mod = pow((60.0 / audio->framerate), 2.5) * 1.54 / audio->noise_reduction;
+    uint32_t rate = data->format.info.raw.rate;
+    double block_seconds = (n_channels > 0 && rate > 0) ? (double)(n_samples / n_channels) / rate : 0.0;
+
+    // Hand the raw block over to the waveform view, the decimation happens on the ui side
+    if (audio->wave != NULL && n_channels > 0) {
+        waveform_push(audio->wave, samples, n_samples / n_channels, n_channels);
+    }
+
+    if (n_channels > 0) {
+        phase_meter_process(&audio->phase, samples, n_samples / n_channels, n_channels, rate);
+    }
 
     // Iterate over the samples
     for (c = 0; c < n_channels; c++) {
@@ -53,14 +65,35 @@ static void on_process(void *userdata) {
             max = fmaxf(max, fabsf(samples[n]));
         }
 
+        float channel_dbs = amplitude_to_db(max);
+
+        // Evaluate the alert rules on the raw block peak, before any smoothing.
+        // amplitude_to_db floors at -60 dB, so digital silence is passed as
+        // -inf to let silence rules with lower thresholds fire on it.
+        if (audio->alerts != NULL) {
+            alerts_process(audio->alerts, c, max > 0.0f ? 20.0f * log10f(max) : -INFINITY, block_seconds);
+        }
+
+        // Keep what happened between two recorded frames
+        if (c < 2) {
+            // The recorder takes the peak from another thread, so only raise it with a CAS
+            int peak = max < INT_MAX / FRAME_PEAK_SCALE ? (int)(max * FRAME_PEAK_SCALE) : INT_MAX;
+            int current = __atomic_load_n(&audio->frame_peak[c], __ATOMIC_RELAXED);
+            while (peak > current &&
+                   !__atomic_compare_exchange_n(&audio->frame_peak[c], &current, peak, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            if (max >= 1.0f) {
+                __atomic_fetch_or(&audio->clip_flags, 1 << c, __ATOMIC_RELAXED);
+            }
+        }
+
         if (c == 0) {
             // Process left channel audio
-            float left_channel_dbs = amplitude_to_db(max);
+            float left_channel_dbs = channel_dbs;
             apply_smoothing(&left_channel_dbs, audio, 0);
             /*audio->audio_out_buffer[c] = left_channel_dbs;*/
         }
         else if (c == 1) {
-            float right_channel_dbs = amplitude_to_db(max);
+            float right_channel_dbs = channel_dbs;
             apply_smoothing(&right_channel_dbs, audio, 1);
         }
     }
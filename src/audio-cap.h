@@ -4,6 +4,11 @@
 #include <pipewire/pipewire.h>
 #include <spa/param/audio/format-utils.h>
 #include <pthread.h>
+#include "alerts.h"
+#include "waveform.h"
+#include "phase.h"
+
+#define FRAME_PEAK_SCALE 1000000.0f // frame_peak holds the linear peak in millionths
 
 /*
  * Main pipewire struct that holds the loop, the stream, and the audio format.
@@ -36,6 +41,15 @@ struct audio_data {
     int terminate;      // To terminate audio thread
     int debug; // Boolean to debug stuff
     int color_theme; // Integer within a range to determine the color theme
+    struct alert_engine *alerts; // Alert rules evaluated on every block, NULL if there are none
+    struct waveform *wave; // Raw samples for the waveform view, NULL when there is no ui
+    struct goniometer *gonio; // Goniometer state for the phase view, NULL when there is no ui
+    struct phase_meter phase; // Correlation between the first two channels
+    int frame_peak[2]; // Highest linear block peak (times FRAME_PEAK_SCALE) since the recorder last took it
+    int clip_flags; // One bit per channel that clipped since the recorder last took them
+    float peak_mark[2]; // Peak drawn as a mark on each bar (e.g. during a replay), not drawn at or below -60 dB
+    char status[128]; // Shown in the top right corner when not empty
+    int view; // Which view is being drawn (see enum vumz_view)
 };
 
 void *input_pipewire(void *audiodata);
@@ -1,6 +1,9 @@
 #include "audio-out.h"
 #include <ncurses.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 
 #define VUMETER_GREEN_THRESHOLD_DB -25.0f
 #define VUMETER_YELLOW_THRESHOLD_DB -10.0f
@@ -9,6 +12,26 @@
 /*static char* fill_percentage[8] = {"█", "▇", "▆", "▅", "▄", "▃", "▂", "▁"};*/
 static char* fill_percentage[9] = {"+", "=", "=", "~", "-", "-", "_", "_", "·"};
 
+// Braille dot bits of a cell indexed by [dot row][dot column] (U+2800 + bits)
+static const unsigned char braille_dots[4][2] = {
+    {0x01, 0x08},
+    {0x02, 0x10},
+    {0x04, 0x20},
+    {0x40, 0x80},
+};
+
+/*
+ * Cell buffers for the braille based views. Each cell holds the dot mask in
+ * the low byte and the color pair in the high byte. cell_shadow is what is on
+ * screen right now, so only the cells that changed get printed again.
+ */
+#define CELL_DIRTY 0xFFFF
+static unsigned short* cells = NULL;
+static unsigned short* cell_shadow = NULL;
+static int cell_rows = 0;
+static int cell_cols = 0;
+static int drawn_view = -1; // View drawn on the previous frame
+
 static double db_to_vu_height(float db, int vu_height)
 {
     // height = 39 when my terminal is using the whole height
@@ -70,6 +93,117 @@ double get_fill_percentage(double input) {
     return percentage;
 }
 
+static long long monotonic_time_in_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void invalidate_cells(int first_row, int n_rows)
+{
+    for (int i = first_row * cell_cols; i < (first_row + n_rows) * cell_cols && i < cell_rows * cell_cols; i++) {
+        cell_shadow[i] = CELL_DIRTY;
+    }
+}
+
+/*
+ * Makes sure the cell buffers match the terminal and clears them for a new
+ * frame. The screen is wiped when the view changes or the terminal is resized.
+ */
+static bool prepare_cells(int view, int rows, int cols)
+{
+    if (rows != cell_rows || cols != cell_cols) {
+        unsigned short* new_cells = realloc(cells, (size_t)rows * cols * sizeof(unsigned short));
+        if (new_cells != NULL) {
+            cells = new_cells;
+        }
+        unsigned short* new_shadow = realloc(cell_shadow, (size_t)rows * cols * sizeof(unsigned short));
+        if (new_shadow != NULL) {
+            cell_shadow = new_shadow;
+        }
+        if (new_cells == NULL || new_shadow == NULL) {
+            return false;
+        }
+
+        cell_rows = rows;
+        cell_cols = cols;
+        drawn_view = -1;
+    }
+
+    if (drawn_view != view) {
+        clear();
+        invalidate_cells(0, cell_rows);
+        drawn_view = view;
+    }
+
+    memset(cells, 0, (size_t)rows * cols * sizeof(unsigned short));
+    return true;
+}
+
+static void set_dot(int dot_y, int dot_x, int color)
+{
+    int index = (dot_y / 4) * cell_cols + dot_x / 2;
+    cells[index] = ((cells[index] | braille_dots[dot_y & 3][dot_x & 1]) & 0xFF) | (color << 8);
+}
+
+// Prints the cells that changed since the last frame
+static void flush_cells()
+{
+    for (int i = 0; i < cell_rows; i++) {
+        for (int j = 0; j < cell_cols; j++) {
+            int index = i * cell_cols + j;
+            if (cells[index] == cell_shadow[index]) {
+                continue;
+            }
+
+            unsigned char mask = cells[index] & 0xFF;
+            int color = cells[index] >> 8;
+
+            attron(COLOR_PAIR(color));
+            if (mask != 0) {
+                // UTF-8 encoding of U+2800 + mask
+                char glyph[4] = {(char)0xE2, (char)(0xA0 | (mask >> 6)), (char)(0x80 | (mask & 0x3F)), '\0'};
+                mvprintw(i, j, "%s", glyph);
+            }
+            else {
+                // Empty cells that have a color are used for guide lines
+                mvprintw(i, j, "%s", color != 0 ? fill_percentage[8] : " ");
+            }
+            attroff(A_COLOR);
+
+            cell_shadow[index] = cells[index];
+        }
+    }
+}
+
+// Color pair for a signal level, following the same rules as the bars
+static int level_color(const struct audio_data* audio, float db)
+{
+    if (audio->color_theme <= 5) {
+        return audio->color_theme;
+    }
+    else if (db < VUMETER_GREEN_THRESHOLD_DB) {
+        return 1;
+    }
+    else if (db < VUMETER_YELLOW_THRESHOLD_DB) {
+        return 2;
+    }
+    return 3;
+}
+
+static int sample_to_dot_row(float sample, int dot_rows)
+{
+    if (sample > 1.0f) {
+        sample = 1.0f;
+    }
+    if (sample < -1.0f) {
+        sample = -1.0f;
+    }
+
+    return (int)((1.0f - sample) * 0.5f * (dot_rows - 1) + 0.5f);
+}
+
 void init_ncurses()
 {
     initscr();              /* Start curses mode */
@@ -104,6 +238,7 @@ void draw_vumeter_data(const struct audio_data* audio) {
     // -- Get terminal dimmensions and calculate color threshold levels --
     int terminal_height, terminal_width;
     getmaxyx(stdscr, terminal_height, terminal_width);
+    drawn_view = VIEW_BARS; // The bars repaint every cell, no need to clear
     int green_threshold_height = db_to_vu_height(VUMETER_GREEN_THRESHOLD_DB, terminal_height);
     int yellow_threshold_height = db_to_vu_height(VUMETER_YELLOW_THRESHOLD_DB, terminal_height);
 
@@ -273,15 +408,184 @@ void draw_vumeter_data(const struct audio_data* audio) {
     }
     attroff(A_COLOR);
 
+    // Peak marks, drawn on the row the bar would reach at that level
+    for (int k = 0; k < 2; k++) {
+        if (audio->peak_mark[k] <= -60.0f) {
+            continue;
+        }
+
+        int mark_height = (int)ceil(db_to_vu_height(audio->peak_mark[k], terminal_height));
+        int mark_row = terminal_height - mark_height;
+        mark_row = mark_row < 0 ? 0 : (mark_row > terminal_height - 2 ? terminal_height - 2 : mark_row);
+        int startx = k == 0 ? startx_left : startx_right;
+
+        if (audio->color_theme <= 5) {
+            attron(COLOR_PAIR(audio->color_theme));
+        }
+        else if (mark_height < green_threshold_height) {
+            attron(COLOR_PAIR(1));
+        }
+        else if (mark_height < yellow_threshold_height) {
+            attron(COLOR_PAIR(2));
+        }
+        else {
+            attron(COLOR_PAIR(3));
+        }
+        attron(A_BOLD);
+        for (int j = startx; j < startx + vu_bar_width; j++) {
+            mvprintw(mark_row, j, "%s", fill_percentage[1]);
+        }
+        attroff(A_COLOR | A_BOLD);
+    }
+
     // Debug
     if (audio->debug == 1) {
         mvprintw(0, 0, "Color theme: %d", audio->color_theme);
         mvprintw(1, 0, "Noise reduction: %.2f", audio->noise_reduction);
     }
+
+    // Status (e.g. replay position)
+    if (audio->status[0] != '\0') {
+        int status_length = strlen(audio->status);
+        mvprintw(0, terminal_width > status_length ? terminal_width - status_length : 0, "%s", audio->status);
+    }
     // Print to debug
     refresh();
 }
 
+/*
+ * Draws every channel as a waveform, stacked vertically. Each terminal column
+ * shows the min/max of the frames it covers, with 4 dots of vertical
+ * resolution per row.
+ */
+void draw_waveform_data(const struct audio_data* audio) {
+    struct waveform* wave = audio->wave;
+    int terminal_height, terminal_width;
+    getmaxyx(stdscr, terminal_height, terminal_width);
+
+    if (wave == NULL || !prepare_cells(VIEW_WAVEFORM, terminal_height, terminal_width)) {
+        return;
+    }
+
+    long long start_time_ns = monotonic_time_in_ns();
+    int n_channels = waveform_decimate(wave, terminal_width);
+    long long decimation_time_ns = monotonic_time_in_ns() - start_time_ns;
+
+    int lane_height = terminal_height / (n_channels > 0 ? n_channels : 1);
+
+    for (int c = 0; c < n_channels && lane_height > 0; c++) {
+        const float* column_min = wave->column_min + (size_t)c * terminal_width;
+        const float* column_max = wave->column_max + (size_t)c * terminal_width;
+        int lane_top = c * lane_height;
+        int dot_rows = lane_height * 4;
+
+        // Zero line
+        for (int j = 0; j < terminal_width; j++) {
+            cells[(lane_top + lane_height / 2) * terminal_width + j] = 6 << 8;
+        }
+
+        for (int j = 0; j < terminal_width; j++) {
+            int top = sample_to_dot_row(column_max[j], dot_rows);
+            int bottom = sample_to_dot_row(column_min[j], dot_rows);
+            float amplitude = fmaxf(fabsf(column_min[j]), fabsf(column_max[j]));
+            int color = level_color(audio, amplitude > 0.0f ? 20.0f * log10f(amplitude) : -60.0f);
+
+            for (int y = top; y <= bottom; y++) {
+                set_dot(lane_top * 4 + y, j * 2, color);
+                set_dot(lane_top * 4 + y, j * 2 + 1, color);
+            }
+        }
+    }
+
+    flush_cells();
+
+    // Debug
+    if (audio->debug == 1) {
+        mvprintw(0, 0, "Color theme: %d", audio->color_theme);
+        mvprintw(1, 0, "Noise reduction: %.2f", audio->noise_reduction);
+        mvprintw(2, 0, "Decimation: %.1f us", decimation_time_ns / 1000.0);
+        invalidate_cells(0, 3);
+    }
+
+    refresh();
+}
+
+/*
+ * Draws the goniometer on top and the correlation meter on the bottom row.
+ * The goniometer is kept square: braille dots are roughly as wide as they
+ * are tall, so the same number of dots is used in both directions.
+ */
+void draw_phase_data(const struct audio_data* audio) {
+    int terminal_height, terminal_width;
+    getmaxyx(stdscr, terminal_height, terminal_width);
+
+    if (audio->gonio == NULL || terminal_height < 4 || !prepare_cells(VIEW_PHASE, terminal_height, terminal_width)) {
+        return;
+    }
+
+    // -- Goniometer --
+    int gonio_rows = terminal_height - 2;
+    int gonio_dots = gonio_rows * 4 < terminal_width * 2 ? gonio_rows * 4 : terminal_width * 2;
+    int gonio_cols = gonio_dots / 2;
+    int startx = (terminal_width - gonio_cols) / 2;
+    gonio_rows = gonio_dots / 4;
+
+    // Mid and side axes
+    for (int i = 0; i < gonio_rows; i++) {
+        cells[i * terminal_width + startx + gonio_cols / 2] = 6 << 8;
+    }
+    for (int j = startx; j < startx + gonio_cols; j++) {
+        cells[(gonio_rows / 2) * terminal_width + j] = 6 << 8;
+    }
+
+    struct goniometer* gonio = audio->gonio;
+    if (goniometer_update(gonio, audio->wave, gonio_cols * 2, gonio_rows * 4)) {
+        for (int y = 0; y < gonio->height; y++) {
+            for (int x = 0; x < gonio->width; x++) {
+                float density = gonio->density[y * gonio->width + x];
+                if (density < 0.5f) {
+                    continue;
+                }
+
+                int color = audio->color_theme <= 5 ? audio->color_theme : (density < 2.0f ? 1 : (density < 8.0f ? 2 : 3));
+                set_dot(y, startx * 2 + x, color);
+            }
+        }
+    }
+
+    // -- Correlation meter --
+    float correlation = audio->phase.correlation;
+    int meter_row = terminal_height - 2;
+    int center_dot = terminal_width; // Two dots per column
+    int end_dot = center_dot + (int)(correlation * (terminal_width - 1));
+    int color = audio->color_theme <= 5 ? audio->color_theme : (correlation < 0.0f ? 3 : (correlation < 0.5f ? 2 : 1));
+
+    for (int j = 0; j < terminal_width; j++) {
+        cells[meter_row * terminal_width + j] = 6 << 8;
+    }
+    for (int x = (end_dot < center_dot ? end_dot : center_dot); x <= (end_dot > center_dot ? end_dot : center_dot); x++) {
+        for (int y = 0; y < 4; y++) {
+            set_dot(meter_row * 4 + y, x, color);
+        }
+    }
+
+    flush_cells();
+
+    mvprintw(terminal_height - 1, 0, "-1");
+    mvprintw(terminal_height - 1, (terminal_width - 6) / 2, "%+.2f", correlation);
+    mvprintw(terminal_height - 1, terminal_width - 2, "+1");
+
+    // Debug
+    if (audio->debug == 1) {
+        mvprintw(0, 0, "Color theme: %d", audio->color_theme);
+        mvprintw(1, 0, "Noise reduction: %.2f", audio->noise_reduction);
+        mvprintw(2, 0, "Correlation window: %.0f ms", audio->phase.window_seconds * 1000.0);
+        invalidate_cells(0, 3);
+    }
+
+    refresh();
+}
+
 void cleanup_ncurses()
 {
     endwin();
@@ -4,8 +4,17 @@
 #include <ncurses.h>
 #include "audio-cap.h"
 
+enum vumz_view {
+    VIEW_BARS,
+    VIEW_WAVEFORM,
+    VIEW_PHASE,
+    VIEW_COUNT
+};
+
 void init_ncurses();
 void draw_vumeter_data(const struct audio_data* audio);
+void draw_waveform_data(const struct audio_data* audio);
+void draw_phase_data(const struct audio_data* audio);
 void cleanup_ncurses();
 
 #endif // AUDIO_OUT_H
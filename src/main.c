@@ -16,10 +16,13 @@
 #include <pthread.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include <signal.h>
 #include <argp.h>
 #include "audio-cap.h"
 #include "audio-out.h"
+#include "alerts.h"
+#include "meter-log.h"
 
 #define CLAMP(val, min, max) (val < min ? min : (val > max ? max : val))
 
@@ -34,16 +37,46 @@ static char doc[] = "VUMZ -- CLI VU Meter Visualizer\v"
                     "\tRight\tSwitch to next color theme\n"
                     "\tUp\tIncrease noise reduction\n"
                     "\tDown\tDecrease noise reduction\n"
+                    "\tv\tSwitch to the next view (bars, waveform, phase)\n"
                     "\td\tToggle debug mode\n"
                     "\tq\tQuit\n"
-                    "\tEscape\tQuit";
+                    "\tEscape\tQuit\n"
+                    "\n"
+                    "Replay keys:\n"
+                    "\tSpace\tPause/resume\n"
+                    "\tf\tFast forward (1x, 2x, 4x, 8x, 16x)\n"
+                    "\t, .\tSeek 5 seconds back/forward\n"
+                    "\t< >\tSeek 1 minute back/forward\n"
+                    "\t0-9\tJump to 0%-90% of the recording\n"
+                    "\n"
+                    "Alert rules have the form TYPE[:DB[:SECONDS[:HYSTERESIS]]]:\n"
+                    "\tclip\tBlock peak at or above DB (default -0.1)\n"
+                    "\tsilence\tBlock peak below DB (default -50) for SECONDS (default 5)\n"
+                    "\tover\tBlock peak above DB (default -6) for SECONDS (default 3)\n"
+                    "Hooks are run as: sh -c CMD vumz TYPE start|end CHANNEL LEVEL";
 
 static char args_doc[] = "";
 
+// Keys for the options that only have a long name
+#define OPT_ALERT_LOG 256
+#define OPT_ALERT_HOOK 257
+#define OPT_CORR_WINDOW 258
+#define OPT_START 259
+
 // Command-line options for argp
 static struct argp_option options[] = {
     {"debug",      'D', 0, 0, "Debug mode: print useful data"},
     {"screensaver",'S', 0, 0, "Screensaver mode: press any key to quit"},
+    {"waveform",   'w', 0, 0, "Start in the waveform view"},
+    {"phase",      'p', 0, 0, "Start in the phase view (goniometer and correlation meter)"},
+    {"corr-window", OPT_CORR_WINDOW, "MS", 0, "Length of the correlation window in milliseconds (default 300)"},
+    {"headless",   'H', 0, 0, "Headless mode: don't draw the vumeter, only run the alerts and the recording"},
+    {"alert",      'a', "RULE", 0, "Add an alert rule (can be used multiple times)"},
+    {"alert-log",  OPT_ALERT_LOG, "FILE", 0, "Append alert events to FILE, - for stdout (default in headless mode)"},
+    {"alert-hook", OPT_ALERT_HOOK, "CMD", 0, "Run CMD for every alert event"},
+    {"record",     'r', "FILE", 0, "Record the meter levels to FILE (every redraw, or every 10ms in headless mode)"},
+    {"replay",     'R', "FILE", 0, "Replay a recording made with --record instead of capturing audio"},
+    {"start",      OPT_START, "TIME", 0, "Start the replay at TIME ([[HH:]MM:]SS)"},
     {0}
 };
 
@@ -51,13 +84,57 @@ static struct argp_option options[] = {
 struct arguments {
     bool debug_mode;
     bool screensaver_mode;
+    bool headless_mode;
+    bool waveform_mode;
+    bool phase_mode;
+    double corr_window_ms;
+    const char *alert_log;
+    const char *alert_hook;
+    const char *record_file;
+    const char *replay_file;
+    double replay_start;
 };
 
 long long current_time_in_ns();
 void handle_sigint(int sig);
+void quit_vumz();
+void handle_key(int c, struct audio_data* audio);
+void record_frame(struct audio_data* audio, long long record_start_ns);
+void run_replay(struct audio_data* audio, long long start_ns);
 
 static double framerate = 60.0;
 static double noise_reduction = 77.0;
+static struct alert_engine alerts = {};
+static bool headless = false;
+static volatile sig_atomic_t quit_requested = 0; // Set by the signal handler, checked by the main loops
+static struct meter_log_writer recorder;
+static bool recording = false;
+static bool record_failed = false;
+static struct meter_log_reader player;
+
+// Parses [[HH:]MM:]SS into seconds, returns a negative number if it is invalid
+static double parse_time(const char *time) {
+    double seconds = 0.0;
+    const char *p = time;
+
+    for (int field = 0; field < 3; field++) {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p || value < 0.0) {
+            return -1.0;
+        }
+        seconds = seconds * 60.0 + value;
+        if (*end == '\0') {
+            return seconds;
+        }
+        if (*end != ':') {
+            return -1.0;
+        }
+        p = end + 1;
+    }
+
+    return -1.0;
+}
 
 // Callback function for parsing individual options
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
@@ -70,6 +147,49 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case 'S':
             arguments->screensaver_mode = true;
             break;
+        case 'H':
+            arguments->headless_mode = true;
+            break;
+        case 'w':
+            arguments->waveform_mode = true;
+            break;
+        case 'p':
+            arguments->phase_mode = true;
+            break;
+        case OPT_CORR_WINDOW:
+            arguments->corr_window_ms = strtod(arg, NULL);
+            if (arguments->corr_window_ms <= 0.0) {
+                argp_error(state, "invalid correlation window '%s'", arg);
+            }
+            break;
+        case 'a':
+            if (alerts_add_rule(&alerts, arg) != 0) {
+                argp_error(state, "invalid alert rule '%s'", arg);
+            }
+            break;
+        case OPT_ALERT_LOG:
+            arguments->alert_log = arg;
+            break;
+        case OPT_ALERT_HOOK:
+            arguments->alert_hook = arg;
+            break;
+        case 'r':
+            arguments->record_file = arg;
+            break;
+        case 'R':
+            arguments->replay_file = arg;
+            break;
+        case OPT_START:
+            arguments->replay_start = parse_time(arg);
+            if (arguments->replay_start < 0.0) {
+                argp_error(state, "invalid start time '%s'", arg);
+            }
+            break;
+        case ARGP_KEY_END:
+            if (arguments->replay_file != NULL && (arguments->record_file != NULL || arguments->headless_mode)) {
+                argp_error(state, "--replay can't be used with --record or --headless");
+            }
+            break;
         case ARGP_KEY_ARG:
             return 0;
         default:
@@ -84,13 +204,39 @@ static struct argp argp = {options, parse_opt, args_doc, doc};
 int main(int argc, char **argv)
 {
     signal(SIGINT, handle_sigint); // Set up signal interrupt
+    signal(SIGTERM, handle_sigint);
 
     // Initialize and parse command-line arguments
     struct arguments arguments = {
         .debug_mode = false,
-        .screensaver_mode = false
+        .screensaver_mode = false,
+        .headless_mode = false,
+        .waveform_mode = false,
+        .phase_mode = false,
+        .corr_window_ms = 300.0,
+        .alert_log = NULL,
+        .alert_hook = NULL,
+        .record_file = NULL,
+        .replay_file = NULL,
+        .replay_start = 0.0
     };
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    headless = arguments.headless_mode;
+
+    // Events go to stdout by default only when there is no ui to mess up
+    if (arguments.alert_log == NULL && headless) {
+        arguments.alert_log = "-";
+    }
+
+    if (arguments.alert_log != NULL && alerts_open_log(&alerts, arguments.alert_log) != 0) {
+        fprintf(stderr, "Error opening alert log %s\n", arguments.alert_log);
+        return EXIT_FAILURE;
+    }
+    alerts.hook = arguments.alert_hook;
+
+    if (alerts.n_rules > 0 && alerts.log == NULL && alerts.hook == NULL) {
+        fprintf(stderr, "Warning: alert rules were given but there is no --alert-log or --alert-hook\n");
+    }
 
     pthread_t audio_thread;
     struct audio_data audio = {};
@@ -105,6 +251,44 @@ int main(int argc, char **argv)
     audio.terminate = 0;
     audio.debug = arguments.debug_mode;
     audio.color_theme = 2;
+    audio.alerts = alerts.n_rules > 0 ? &alerts : NULL;
+    audio.view = arguments.phase_mode ? VIEW_PHASE : (arguments.waveform_mode ? VIEW_WAVEFORM : VIEW_BARS);
+    audio.phase.window_seconds = arguments.corr_window_ms / 1000.0;
+    audio.peak_mark[0] = -60.0f;
+    audio.peak_mark[1] = -60.0f;
+
+    if (arguments.replay_file != NULL) {
+        if (meter_log_open(&player, arguments.replay_file) != 0) {
+            fprintf(stderr, "Error opening recording %s\n", arguments.replay_file);
+            return EXIT_FAILURE;
+        }
+
+        // The levels come from the recording, there is no audio to capture
+        audio.view = VIEW_BARS;
+        setlocale(LC_ALL, "");
+        init_ncurses();
+        run_replay(&audio, (long long)(arguments.replay_start * 1000000000.0));
+        return EXIT_SUCCESS;
+    }
+
+    // Only keep raw samples around if there is a screen to draw them on
+    if (!headless) {
+        audio.wave = waveform_new();
+        audio.gonio = goniometer_new();
+        if (audio.wave == NULL || audio.gonio == NULL) {
+            fprintf(stderr, "Error allocating the waveform buffers\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (arguments.record_file != NULL) {
+        if (meter_log_create(&recorder, arguments.record_file, 2) != 0) {
+            fprintf(stderr, "Error creating recording %s\n", arguments.record_file);
+            return EXIT_FAILURE;
+        }
+        recording = true;
+    }
+    long long record_start_ns = current_time_in_ns();
 
     pthread_mutex_init(&audio.lock, NULL);
 
@@ -114,6 +298,18 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    if (headless) {
+        // Nothing to draw, just hand the alert events over to the log and hooks
+        while (!audio.terminate && !quit_requested) {
+            alerts_flush(&alerts);
+            if (recording) {
+                record_frame(&audio, record_start_ns);
+            }
+            usleep(10000);
+        }
+        quit_vumz();
+    }
+
     printf("Initializing\n");
     setlocale(LC_ALL, ""); // Set locale so unicode characters work properly
     init_ncurses();
@@ -125,42 +321,37 @@ int main(int argc, char **argv)
     {
         long long start_time_ns = current_time_in_ns();
 
+        if (quit_requested || audio.terminate) {
+            quit_vumz();
+        }
+
         if (arguments.screensaver_mode && getch() != ERR)
         {
-            handle_sigint(0);
-            break;
+            quit_vumz();
         }
         else if (!arguments.screensaver_mode)
         {
-            int c = getch();
-            switch (c) {
-                case KEY_UP:
-                    audio.noise_reduction += 1.0;
-                    break;
-                case KEY_DOWN:
-                    audio.noise_reduction -= 1.0;
-                    break;
-                case KEY_LEFT:
-                    audio.color_theme -= 1;
-                    if (audio.color_theme < 0) audio.color_theme = 6;
-                    break;
-                case KEY_RIGHT:
-                    audio.color_theme = (audio.color_theme + 1) % 7;
-                    break;
-                case 'd':
-                    audio.debug = audio.debug == 1 ? 0 : 1;
-                    break;
-                case 'q': // Quit on 'q'
-                case 27: // Escape key (ASCII 27)
-                    handle_sigint(0);
-                    break;
-            }
-
-            audio.noise_reduction = CLAMP(audio.noise_reduction, 0, 200);
+            handle_key(getch(), &audio);
         }
 
         // Draw vumeter data
-        draw_vumeter_data(&audio);
+        if (audio.view == VIEW_WAVEFORM) {
+            draw_waveform_data(&audio);
+        }
+        else if (audio.view == VIEW_PHASE) {
+            draw_phase_data(&audio);
+        }
+        else {
+            draw_vumeter_data(&audio);
+        }
+
+        if (audio.alerts != NULL) {
+            alerts_flush(audio.alerts);
+        }
+
+        if (recording) {
+            record_frame(&audio, record_start_ns);
+        }
 
         long long frame_duration_ns = current_time_in_ns() - start_time_ns;
 
@@ -183,9 +374,230 @@ long long current_time_in_ns() {
     return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
+/*
+ * Only flags the request, the main loops see it and call quit_vumz() so that
+ * closing the recording and the alert log never happens inside the handler.
+ */
 void handle_sigint(int sig) {
-    cleanup_ncurses();
+    quit_requested = 1;
+}
+
+void quit_vumz() {
+    alerts_close(&alerts);
+    if (recording && meter_log_close(&recorder) != 0) {
+        record_failed = true;
+    }
+    recording = false;
+
+    if (!headless) {
+        cleanup_ncurses();
+    }
+    if (record_failed) {
+        fprintf(stderr, "Error writing the recording, it may be incomplete\n");
+    }
+    if (headless) {
+        exit(EXIT_SUCCESS);
+    }
     printf("Thank you for using vumz :)\n");
     exit(EXIT_SUCCESS);
 }
 
+// Keys shared by the live and replay modes
+void handle_key(int c, struct audio_data* audio) {
+    switch (c) {
+        case KEY_UP:
+            audio->noise_reduction += 1.0;
+            break;
+        case KEY_DOWN:
+            audio->noise_reduction -= 1.0;
+            break;
+        case KEY_LEFT:
+            audio->color_theme -= 1;
+            if (audio->color_theme < 0) audio->color_theme = 6;
+            break;
+        case KEY_RIGHT:
+            audio->color_theme = (audio->color_theme + 1) % 7;
+            break;
+        case 'v':
+            // The other views need raw audio, which a replay doesn't have
+            if (audio->wave != NULL) {
+                audio->view = (audio->view + 1) % VIEW_COUNT;
+            }
+            break;
+        case 'd':
+            audio->debug = audio->debug == 1 ? 0 : 1;
+            break;
+        case 'q': // Quit on 'q'
+        case 27: // Escape key (ASCII 27)
+            quit_vumz();
+            break;
+    }
+
+    audio->noise_reduction = CLAMP(audio->noise_reduction, 0, 200);
+}
+
+// Appends what the vumeter is showing right now to the recording
+void record_frame(struct audio_data* audio, long long record_start_ns) {
+    struct meter_frame frame = {};
+    frame.timestamp_ns = current_time_in_ns() - record_start_ns;
+
+    for (int c = 0; c < 2; c++) {
+        frame.level[c] = audio->audio_out_buffer[c];
+        int peak = __atomic_exchange_n(&audio->frame_peak[c], 0, __ATOMIC_RELAXED);
+        frame.peak[c] = peak > 0 ? 20.0f * log10f(peak / FRAME_PEAK_SCALE) : -60.0f;
+    }
+    frame.clip = __atomic_exchange_n(&audio->clip_flags, 0, __ATOMIC_RELAXED);
+
+    if (meter_log_append(&recorder, &frame) != 0) {
+        // Stop recording but keep what was written so far
+        meter_log_close(&recorder);
+        recording = false;
+        record_failed = true;
+    }
+}
+
+static void format_duration(char* buffer, size_t size, long long ns) {
+    long long seconds = ns / 1000000000LL;
+    snprintf(buffer, size, "%02lld:%02lld:%02lld", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+}
+
+/*
+ * Plays a recording back through draw_vumeter_data. The playback position
+ * follows the wall clock (times the speed) and the reader only decodes the
+ * frames in between, seeks go through the chunk index.
+ */
+void run_replay(struct audio_data* audio, long long start_ns) {
+    static const int speeds[] = {1, 2, 4, 8, 16};
+    int speed_index = 0;
+    bool paused = false;
+    long long position_ns = CLAMP(start_ns, 0, player.duration_ns);
+    long long clip_until_ns = -1;
+    uint32_t clip_channels = 0;
+    float peak_hold[2] = {-60.0f, -60.0f};
+    long long peak_hold_until_ns[2] = {-1, -1};
+
+    const long long target_frame_time_ns = 16666666LL; // 16.67 milliseconds in nanoseconds (1/60 in ms)
+    long long last_time_ns = current_time_in_ns();
+
+    meter_log_seek(&player, position_ns);
+
+    while (true)
+    {
+        long long start_time_ns = current_time_in_ns();
+        bool seek = false;
+
+        if (quit_requested) {
+            quit_vumz();
+        }
+
+        int c = getch();
+        switch (c) {
+            case ' ':
+                paused = !paused;
+                // Start over when resuming at the end
+                if (!paused && position_ns >= player.duration_ns) {
+                    position_ns = 0;
+                    seek = true;
+                }
+                break;
+            case 'f':
+                speed_index = (speed_index + 1) % (int)(sizeof(speeds) / sizeof(speeds[0]));
+                break;
+            case ',':
+                position_ns -= 5000000000LL;
+                seek = true;
+                break;
+            case '.':
+                position_ns += 5000000000LL;
+                seek = true;
+                break;
+            case '<':
+                position_ns -= 60000000000LL;
+                seek = true;
+                break;
+            case '>':
+                position_ns += 60000000000LL;
+                seek = true;
+                break;
+            default:
+                if (c >= '0' && c <= '9') {
+                    position_ns = player.duration_ns / 10 * (c - '0');
+                    seek = true;
+                }
+                else {
+                    handle_key(c, audio);
+                }
+                break;
+        }
+
+        if (!paused) {
+            position_ns += (start_time_ns - last_time_ns) * speeds[speed_index];
+        }
+        last_time_ns = start_time_ns;
+
+        if (position_ns >= player.duration_ns) {
+            paused = true;
+        }
+        position_ns = CLAMP(position_ns, 0, player.duration_ns);
+
+        if (seek) {
+            meter_log_seek(&player, position_ns);
+            clip_channels = 0;
+        }
+        else {
+            meter_log_advance(&player, position_ns);
+        }
+
+        // Keep clips on screen for a second so they can be seen
+        if (player.clip_seen != 0) {
+            clip_channels = player.clip_seen;
+            clip_until_ns = position_ns + 1000000000LL;
+            player.clip_seen = 0;
+        }
+        else if (position_ns > clip_until_ns) {
+            clip_channels = 0;
+        }
+
+        for (int i = 0; i < 2; i++) {
+            int channel = i < (int)player.n_channels ? i : 0;
+            audio->audio_out_buffer[i] = player.frame.level[channel];
+            audio->audio_out_buffer_prev[i] = player.frame.level[channel];
+
+            // Hold the highest recorded peak for a moment, like a peak meter would
+            float peak = fmaxf(player.peak_seen[channel], player.frame.peak[channel]);
+            if (seek || peak >= peak_hold[i] || position_ns > peak_hold_until_ns[i]) {
+                peak_hold[i] = peak;
+                peak_hold_until_ns[i] = position_ns + 1500000000LL;
+            }
+            audio->peak_mark[i] = peak_hold[i];
+        }
+        for (unsigned int i = 0; i < player.n_channels; i++) {
+            player.peak_seen[i] = -INFINITY;
+        }
+
+        // -- Status line --
+        char clock_str[16], position_str[32], duration_str[32];
+        time_t wall_time = (time_t)((player.start_time_ns + position_ns) / 1000000000LL);
+        struct tm tm;
+        localtime_r(&wall_time, &tm);
+        strftime(clock_str, sizeof(clock_str), "%H:%M:%S", &tm);
+        format_duration(position_str, sizeof(position_str), position_ns);
+        format_duration(duration_str, sizeof(duration_str), player.duration_ns);
+
+        snprintf(audio->status, sizeof(audio->status), "%s%s%s  %s  %s / %s  x%d%s ",
+                 clip_channels != 0 ? "CLIP" : "",
+                 clip_channels & 1 ? " L" : "",
+                 clip_channels & 2 ? " R" : "",
+                 clock_str, position_str, duration_str, speeds[speed_index],
+                 paused ? "  PAUSED" : "");
+
+        draw_vumeter_data(audio);
+
+        long long frame_duration_ns = current_time_in_ns() - start_time_ns;
+
+        if (frame_duration_ns < target_frame_time_ns) {
+            usleep((target_frame_time_ns - frame_duration_ns) / 1000); // sleep for the remaining time in us
+        }
+    }
+}
+
@@ -0,0 +1,500 @@
+/*
+ * Meter log recording and replay
+ */
+
+#include "meter-log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Longest encoded frame: timestamp, two values per channel and the clip flags
+#define METER_LOG_MAX_FRAME_SIZE (10 + METER_LOG_MAX_CHANNELS * 2 * 5 + 5)
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value)
+{
+    while (value >= 0x80) {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+// Returns NULL if the varint runs past end
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *value)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+// Maps small negative and positive deltas to small unsigned numbers
+static uint32_t zigzag_encode(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// dB to hundredths of dB
+static int32_t quantize_db(float db)
+{
+    // Written this way so NaN ends up at the bottom too
+    if (!(db > -1000.0f)) {
+        db = -1000.0f;
+    }
+    if (db > 1000.0f) {
+        db = 1000.0f;
+    }
+
+    return (int32_t)lrintf(db * 100.0f);
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+int meter_log_create(struct meter_log_writer *writer, const char *path, unsigned int n_channels)
+{
+    if (n_channels == 0 || n_channels > METER_LOG_MAX_CHANNELS) {
+        return -1;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        return -1;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    struct meter_log_header header = { .version = METER_LOG_VERSION, .n_channels = n_channels };
+    memcpy(header.magic, METER_LOG_MAGIC, sizeof(METER_LOG_MAGIC));
+    header.start_time_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    if (write_all(writer->fd, &header, sizeof(header)) != 0) {
+        close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+
+    writer->n_channels = n_channels;
+    writer->offset = sizeof(header);
+    return 0;
+}
+
+// Writes the chunk being filled with a single write and adds it to the index
+static int flush_chunk(struct meter_log_writer *writer)
+{
+    if (writer->n_frames == 0) {
+        return 0;
+    }
+
+    if (writer->n_chunks == writer->index_capacity) {
+        size_t capacity = writer->index_capacity > 0 ? writer->index_capacity * 2 : 64;
+        struct meter_log_index_entry *index = realloc(writer->index, capacity * sizeof(*index));
+        if (index == NULL) {
+            return -1;
+        }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+
+    struct meter_log_chunk header = {
+        .magic = METER_LOG_CHUNK_MAGIC,
+        .size = (uint32_t)writer->used,
+        .n_frames = writer->n_frames,
+        .start_ns = writer->chunk_start_ns,
+    };
+    memcpy(writer->chunk, &header, sizeof(header));
+
+    if (write_all(writer->fd, writer->chunk, sizeof(header) + writer->used) != 0) {
+        return -1;
+    }
+
+    writer->index[writer->n_chunks].start_ns = writer->chunk_start_ns;
+    writer->index[writer->n_chunks].offset = writer->offset;
+    writer->n_chunks++;
+
+    writer->offset += sizeof(header) + writer->used;
+    writer->used = 0;
+    writer->n_frames = 0;
+    return 0;
+}
+
+int meter_log_append(struct meter_log_writer *writer, const struct meter_frame *frame)
+{
+    if (writer->n_frames > 0 &&
+        (writer->used + METER_LOG_MAX_FRAME_SIZE > METER_LOG_CHUNK_SIZE || writer->n_frames >= METER_LOG_CHUNK_FRAMES)) {
+        if (flush_chunk(writer) != 0) {
+            return -1;
+        }
+    }
+
+    // Every chunk starts from a clean state so it can be decoded on its own
+    if (writer->n_frames == 0) {
+        writer->chunk_start_ns = frame->timestamp_ns;
+        writer->last_ns = frame->timestamp_ns;
+        memset(writer->last_level, 0, sizeof(writer->last_level));
+        memset(writer->last_peak, 0, sizeof(writer->last_peak));
+    }
+
+    unsigned char *start = writer->chunk + sizeof(struct meter_log_chunk) + writer->used;
+    unsigned char *p = start;
+
+    // Keep last_ns at what the reader will see so rounding doesn't pile up
+    int64_t delta_us = (frame->timestamp_ns - writer->last_ns) / 1000;
+    if (delta_us < 0) {
+        delta_us = 0;
+    }
+    writer->last_ns += delta_us * 1000;
+    p = put_varint(p, (uint64_t)delta_us);
+
+    for (unsigned int c = 0; c < writer->n_channels; c++) {
+        int32_t level = quantize_db(frame->level[c]);
+        int32_t peak = quantize_db(frame->peak[c]);
+        p = put_varint(p, zigzag_encode(level - writer->last_level[c]));
+        p = put_varint(p, zigzag_encode(peak - writer->last_peak[c]));
+        writer->last_level[c] = level;
+        writer->last_peak[c] = peak;
+    }
+
+    p = put_varint(p, frame->clip & ((1u << writer->n_channels) - 1));
+
+    writer->used += p - start;
+    writer->n_frames++;
+    return 0;
+}
+
+/*
+ * Writes what is left, then the index, and finally points the header at the
+ * index. Until this runs the file is still readable, only without an index.
+ */
+int meter_log_close(struct meter_log_writer *writer)
+{
+    static const unsigned char padding[8] = {0};
+
+    if (writer->fd < 0) {
+        return -1;
+    }
+
+    int status = flush_chunk(writer);
+
+    // Align the index so it can be used straight from the mapping
+    size_t padding_size = (8 - writer->offset % 8) % 8;
+    uint64_t index_offset = writer->offset + padding_size;
+
+    if (status == 0) {
+        status = write_all(writer->fd, padding, padding_size);
+    }
+    if (status == 0) {
+        status = write_all(writer->fd, writer->index, writer->n_chunks * sizeof(struct meter_log_index_entry));
+    }
+    if (status == 0 &&
+        pwrite(writer->fd, &index_offset, sizeof(index_offset), offsetof(struct meter_log_header, index_offset)) != sizeof(index_offset)) {
+        status = -1;
+    }
+
+    if (close(writer->fd) != 0) {
+        status = -1;
+    }
+    free(writer->index);
+    writer->fd = -1;
+    writer->index = NULL;
+    writer->n_chunks = 0;
+    writer->index_capacity = 0;
+
+    return status;
+}
+
+// Prepares the reader to decode a chunk from its first frame
+static int load_chunk(struct meter_log_reader *reader, size_t chunk)
+{
+    struct meter_log_chunk header;
+
+    if (chunk >= reader->n_chunks) {
+        return -1;
+    }
+
+    uint64_t offset = reader->index[chunk].offset;
+    if (offset > reader->size || reader->size - offset < sizeof(header)) {
+        return -1;
+    }
+
+    memcpy(&header, reader->map + offset, sizeof(header));
+    if (header.magic != METER_LOG_CHUNK_MAGIC || header.size > reader->size - offset - sizeof(header)) {
+        return -1;
+    }
+
+    reader->chunk = chunk;
+    reader->pos = reader->map + offset + sizeof(header);
+    reader->chunk_end = reader->pos + header.size;
+    reader->frames_left = header.n_frames;
+    reader->last_ns = header.start_ns;
+    memset(reader->last_level, 0, sizeof(reader->last_level));
+    memset(reader->last_peak, 0, sizeof(reader->last_peak));
+    return 0;
+}
+
+/*
+ * Decodes the frame at the current position, moving on to the following
+ * chunks when needed. A damaged chunk is skipped. Returns -1 at the end.
+ */
+static int decode_frame(struct meter_log_reader *reader, struct meter_frame *out)
+{
+    for (;;) {
+        while (reader->frames_left == 0) {
+            if (load_chunk(reader, reader->chunk + 1) != 0) {
+                return -1;
+            }
+        }
+
+        const unsigned char *p = reader->pos;
+        uint64_t value;
+
+        memset(out, 0, sizeof(*out));
+
+        if ((p = get_varint(p, reader->chunk_end, &value)) == NULL) {
+            reader->frames_left = 0;
+            continue;
+        }
+        reader->last_ns += (int64_t)value * 1000;
+        out->timestamp_ns = reader->last_ns;
+
+        for (unsigned int c = 0; c < reader->n_channels && p != NULL; c++) {
+            if ((p = get_varint(p, reader->chunk_end, &value)) != NULL) {
+                reader->last_level[c] += zigzag_decode((uint32_t)value);
+                out->level[c] = reader->last_level[c] / 100.0f;
+                p = get_varint(p, reader->chunk_end, &value);
+            }
+            if (p != NULL) {
+                reader->last_peak[c] += zigzag_decode((uint32_t)value);
+                out->peak[c] = reader->last_peak[c] / 100.0f;
+            }
+        }
+
+        if (p == NULL || (p = get_varint(p, reader->chunk_end, &value)) == NULL) {
+            reader->frames_left = 0;
+            continue;
+        }
+        out->clip = (uint32_t)value;
+
+        reader->pos = p;
+        reader->frames_left--;
+        return 0;
+    }
+}
+
+// Builds the index by hopping over the chunk headers, for files that were never closed
+static int scan_chunks(struct meter_log_reader *reader)
+{
+    uint64_t offset = sizeof(struct meter_log_header);
+    size_t capacity = 0;
+
+    while (reader->size - offset >= sizeof(struct meter_log_chunk)) {
+        struct meter_log_chunk header;
+        memcpy(&header, reader->map + offset, sizeof(header));
+
+        // A truncated chunk at the end is dropped
+        if (header.magic != METER_LOG_CHUNK_MAGIC || header.size > reader->size - offset - sizeof(header)) {
+            break;
+        }
+
+        if (reader->n_chunks == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            struct meter_log_index_entry *index = realloc(reader->scanned_index, capacity * sizeof(*index));
+            if (index == NULL) {
+                return -1;
+            }
+            reader->scanned_index = index;
+        }
+
+        reader->scanned_index[reader->n_chunks].start_ns = header.start_ns;
+        reader->scanned_index[reader->n_chunks].offset = offset;
+        reader->n_chunks++;
+
+        offset += sizeof(header) + header.size;
+    }
+
+    reader->index = reader->scanned_index;
+    return 0;
+}
+
+/*
+ * Maps a recording and positions the reader at its first frame. Nothing is
+ * read up front besides the header and the last chunk (for the duration).
+ */
+int meter_log_open(struct meter_log_reader *reader, const char *path)
+{
+    struct meter_log_header header;
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    reader->map = map;
+    reader->size = st.st_size;
+
+    memcpy(&header, reader->map, sizeof(header));
+    if (memcmp(header.magic, METER_LOG_MAGIC, sizeof(METER_LOG_MAGIC)) != 0 ||
+        header.version != METER_LOG_VERSION ||
+        header.n_channels == 0 || header.n_channels > METER_LOG_MAX_CHANNELS) {
+        meter_log_unmap(reader);
+        return -1;
+    }
+
+    reader->n_channels = header.n_channels;
+    reader->start_time_ns = header.start_time_ns;
+
+    if (header.index_offset >= sizeof(header) && header.index_offset <= reader->size &&
+        header.index_offset % 8 == 0 &&
+        (reader->size - header.index_offset) % sizeof(struct meter_log_index_entry) == 0) {
+        reader->index = (const struct meter_log_index_entry *)(reader->map + header.index_offset);
+        reader->n_chunks = (reader->size - header.index_offset) / sizeof(struct meter_log_index_entry);
+    }
+    else if (scan_chunks(reader) != 0) {
+        meter_log_unmap(reader);
+        return -1;
+    }
+
+    if (reader->n_chunks == 0) {
+        meter_log_unmap(reader);
+        return -1;
+    }
+
+    // The duration is the timestamp of the very last frame
+    struct meter_frame frame;
+    reader->duration_ns = reader->index[reader->n_chunks - 1].start_ns;
+    if (load_chunk(reader, reader->n_chunks - 1) == 0) {
+        while (reader->frames_left > 0 && decode_frame(reader, &frame) == 0) {
+            reader->duration_ns = frame.timestamp_ns;
+        }
+    }
+
+    if (meter_log_seek(reader, 0) != 0) {
+        meter_log_unmap(reader);
+        return -1;
+    }
+
+    for (unsigned int c = 0; c < METER_LOG_MAX_CHANNELS; c++) {
+        reader->peak_seen[c] = -INFINITY;
+    }
+
+    return 0;
+}
+
+static void step_frame(struct meter_log_reader *reader)
+{
+    reader->frame = reader->next;
+    reader->has_next = decode_frame(reader, &reader->next) == 0;
+}
+
+/*
+ * Moves to the last frame at or before timestamp_ns. The chunk is found with
+ * a binary search over the index, then at most one chunk is decoded.
+ */
+int meter_log_seek(struct meter_log_reader *reader, int64_t timestamp_ns)
+{
+    size_t low = 0;
+    size_t high = reader->n_chunks;
+
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (reader->index[mid].start_ns <= timestamp_ns) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    if (load_chunk(reader, low) != 0 || decode_frame(reader, &reader->frame) != 0) {
+        return -1;
+    }
+    reader->has_next = decode_frame(reader, &reader->next) == 0;
+
+    while (reader->has_next && reader->next.timestamp_ns <= timestamp_ns) {
+        step_frame(reader);
+    }
+
+    return 0;
+}
+
+/*
+ * Plays forward up to timestamp_ns, collecting the clip flags on the way.
+ * Going backwards or skipping over whole chunks is handed to the seek.
+ */
+void meter_log_advance(struct meter_log_reader *reader, int64_t timestamp_ns)
+{
+    if (timestamp_ns < reader->frame.timestamp_ns ||
+        (reader->chunk + 2 < reader->n_chunks && reader->index[reader->chunk + 2].start_ns <= timestamp_ns)) {
+        meter_log_seek(reader, timestamp_ns);
+        return;
+    }
+
+    while (reader->has_next && reader->next.timestamp_ns <= timestamp_ns) {
+        step_frame(reader);
+        reader->clip_seen |= reader->frame.clip;
+        for (unsigned int c = 0; c < reader->n_channels; c++) {
+            reader->peak_seen[c] = fmaxf(reader->peak_seen[c], reader->frame.peak[c]);
+        }
+    }
+}
+
+void meter_log_unmap(struct meter_log_reader *reader)
+{
+    if (reader->map != NULL) {
+        munmap((void *)reader->map, reader->size);
+    }
+    free(reader->scanned_index);
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,112 @@
+#ifndef METER_LOG_H
+#define METER_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define METER_LOG_MAGIC "VUMZLOG"
+#define METER_LOG_VERSION 1
+#define METER_LOG_CHUNK_MAGIC 0x4b4e4843 // "CHNK"
+#define METER_LOG_MAX_CHANNELS 8
+#define METER_LOG_CHUNK_SIZE 4096   // Max payload bytes buffered before a chunk is written
+#define METER_LOG_CHUNK_FRAMES 256  // Max frames per chunk, bounds the work of a seek
+
+/*
+ * On disk layout (native byte order):
+ *
+ *   header | chunk | chunk | ... | padding | index
+ *
+ * Every chunk starts from a clean delta state so it can be decoded on its
+ * own. The index has one entry per chunk and is written when the recording
+ * is closed. If it is missing the chunks are scanned instead.
+ */
+struct meter_log_header {
+    char magic[8];          // METER_LOG_MAGIC
+    uint32_t version;
+    uint32_t n_channels;
+    int64_t start_time_ns;  // Wall clock time when the recording started
+    uint64_t index_offset;  // Where the index starts, 0 if the file was never closed
+};
+
+struct meter_log_chunk {
+    uint32_t magic;         // METER_LOG_CHUNK_MAGIC
+    uint32_t size;          // Payload bytes after this header
+    uint32_t n_frames;
+    uint32_t reserved;
+    int64_t start_ns;       // Timestamp of the first frame
+};
+
+struct meter_log_index_entry {
+    int64_t start_ns;       // Timestamp of the first frame of the chunk
+    uint64_t offset;        // File offset of the chunk header
+};
+
+/*
+ * A single meter frame. Each frame is stored as varints: the timestamp delta
+ * in microseconds, then the level and peak deltas (in hundredths of dB,
+ * zigzag encoded) of every channel, and finally the clip flags.
+ */
+struct meter_frame {
+    int64_t timestamp_ns;   // Time since the start of the recording
+    float level[METER_LOG_MAX_CHANNELS];    // Level shown by the vumeter in dB
+    float peak[METER_LOG_MAX_CHANNELS];     // Highest block peak since the previous frame in dB
+    uint32_t clip;          // One bit per channel
+};
+
+struct meter_log_writer {
+    int fd;
+    unsigned int n_channels;
+    uint64_t offset;        // Where the next chunk goes
+
+    // Chunk being filled
+    unsigned char chunk[sizeof(struct meter_log_chunk) + METER_LOG_CHUNK_SIZE];
+    size_t used;
+    uint32_t n_frames;
+    int64_t chunk_start_ns;
+    int64_t last_ns;
+    int32_t last_level[METER_LOG_MAX_CHANNELS];
+    int32_t last_peak[METER_LOG_MAX_CHANNELS];
+
+    // Index of the chunks written so far
+    struct meter_log_index_entry *index;
+    size_t n_chunks;
+    size_t index_capacity;
+};
+
+struct meter_log_reader {
+    const unsigned char *map;
+    size_t size;
+    unsigned int n_channels;
+    int64_t start_time_ns;
+    int64_t duration_ns;    // Timestamp of the last frame
+
+    const struct meter_log_index_entry *index;
+    size_t n_chunks;
+    struct meter_log_index_entry *scanned_index; // Only used when the file has no index
+
+    // Decoding position
+    size_t chunk;
+    const unsigned char *pos;
+    const unsigned char *chunk_end;
+    uint32_t frames_left;
+    int64_t last_ns;
+    int32_t last_level[METER_LOG_MAX_CHANNELS];
+    int32_t last_peak[METER_LOG_MAX_CHANNELS];
+
+    struct meter_frame frame;   // Frame at the playback position
+    struct meter_frame next;    // Frame after it
+    int has_next;
+    uint32_t clip_seen;         // Clip flags of every frame passed since the caller last cleared it
+    float peak_seen[METER_LOG_MAX_CHANNELS]; // Highest peak of every frame passed since the caller last reset it
+};
+
+int meter_log_create(struct meter_log_writer *writer, const char *path, unsigned int n_channels);
+int meter_log_append(struct meter_log_writer *writer, const struct meter_frame *frame);
+int meter_log_close(struct meter_log_writer *writer);
+
+int meter_log_open(struct meter_log_reader *reader, const char *path);
+int meter_log_seek(struct meter_log_reader *reader, int64_t timestamp_ns);
+void meter_log_advance(struct meter_log_reader *reader, int64_t timestamp_ns);
+void meter_log_unmap(struct meter_log_reader *reader);
+
+#endif // METER_LOG_H
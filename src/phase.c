@@ -0,0 +1,188 @@
+/*
+ * Stereo phase correlation and goniometer
+ */
+
+#include "phase.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/*
+ * Sums L * R, L * L and R * R over an interleaved stereo block. Four floats
+ * hold two frames, so the squares give [LL RR LL RR] and multiplying by the
+ * pair swapped vector gives [LR RL LR RL].
+ */
+static void stereo_block_sums(const float *samples, uint32_t n_frames, float *sum_lr, float *sum_ll, float *sum_rr)
+{
+    float lr = 0.0f, ll = 0.0f, rr = 0.0f;
+    uint32_t n = 0;
+
+#if defined(__SSE__)
+    __m128 vsq = _mm_setzero_ps();
+    __m128 vlr = _mm_setzero_ps();
+
+    for (; n + 2 <= n_frames; n += 2) {
+        __m128 v = _mm_loadu_ps(samples + n * 2);
+        vsq = _mm_add_ps(vsq, _mm_mul_ps(v, v));
+        vlr = _mm_add_ps(vlr, _mm_mul_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+
+    float sq[4], cross[4];
+    _mm_storeu_ps(sq, vsq);
+    _mm_storeu_ps(cross, vlr);
+    ll = sq[0] + sq[2];
+    rr = sq[1] + sq[3];
+    lr = cross[0] + cross[2];
+#endif
+
+    for (; n < n_frames; n++) {
+        float l = samples[n * 2];
+        float r = samples[n * 2 + 1];
+        lr += l * r;
+        ll += l * l;
+        rr += r * r;
+    }
+
+    *sum_lr = lr;
+    *sum_ll = ll;
+    *sum_rr = rr;
+}
+
+/*
+ * Called from the audio thread for every block. Only the first two channels
+ * are used, anything with less than two channels is left alone.
+ */
+void phase_meter_process(struct phase_meter *phase, const float *samples, uint32_t n_frames, uint32_t n_channels, uint32_t rate)
+{
+    if (n_channels < 2 || n_frames == 0 || rate == 0) {
+        return;
+    }
+
+    float lr = 0.0f, ll = 0.0f, rr = 0.0f;
+    if (n_channels == 2) {
+        stereo_block_sums(samples, n_frames, &lr, &ll, &rr);
+    }
+    else {
+        for (uint32_t n = 0; n < n_frames; n++) {
+            float l = samples[n * n_channels];
+            float r = samples[n * n_channels + 1];
+            lr += l * r;
+            ll += l * l;
+            rr += r * r;
+        }
+    }
+
+    // Decay the previous sums by the length of this block
+    double decay = exp(-(double)n_frames / (rate * phase->window_seconds));
+    phase->sum_lr = phase->sum_lr * decay + lr;
+    phase->sum_ll = phase->sum_ll * decay + ll;
+    phase->sum_rr = phase->sum_rr * decay + rr;
+
+    double energy = sqrt(phase->sum_ll * phase->sum_rr);
+    phase->correlation = energy > 1e-9 ? (float)(phase->sum_lr / energy) : 0.0f;
+}
+
+struct goniometer *goniometer_new()
+{
+    struct goniometer *gonio = calloc(1, sizeof(struct goniometer));
+    if (gonio != NULL) {
+        gonio->decay = 0.8f;
+    }
+    return gonio;
+}
+
+void goniometer_free(struct goniometer *gonio)
+{
+    if (gonio == NULL) {
+        return;
+    }
+
+    free(gonio->density);
+    free(gonio);
+}
+
+static float clamp_to_grid(float position, int size)
+{
+    // Written this way so NaN ends up at 0 too
+    if (!(position >= 0.0f)) {
+        return 0.0f;
+    }
+    if (position > size - 1) {
+        return size - 1;
+    }
+    return position;
+}
+
+/*
+ * Fades the density grid and plots every frame that arrived since the last
+ * call. Side goes on the horizontal axis and mid on the vertical one, so a
+ * mono signal is a vertical line. Returns 0 if there is nothing to plot.
+ */
+int goniometer_update(struct goniometer *gonio, const struct waveform *wave, int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    if (width != gonio->width || height != gonio->height) {
+        float *density = realloc(gonio->density, (size_t)width * height * sizeof(float));
+        if (density == NULL) {
+            return 0;
+        }
+        memset(density, 0, (size_t)width * height * sizeof(float));
+        gonio->density = density;
+        gonio->width = width;
+        gonio->height = height;
+    }
+
+    float *density = gonio->density;
+    for (int i = 0; i < width * height; i++) {
+        density[i] *= gonio->decay;
+    }
+
+    if (__atomic_load_n(&wave->n_channels, __ATOMIC_RELAXED) < 2) {
+        return 0;
+    }
+
+    unsigned int end = __atomic_load_n(&wave->write_pos, __ATOMIC_ACQUIRE);
+
+    // Skip what was overwritten or happened too long ago to matter
+    if (end - gonio->read_pos > WAVE_RING_FRAMES / 2) {
+        gonio->read_pos = end - WAVE_WINDOW_FRAMES;
+    }
+
+    while (gonio->read_pos != end) {
+        unsigned int n_frames = end - gonio->read_pos;
+        if (n_frames > WAVE_WINDOW_FRAMES) {
+            n_frames = WAVE_WINDOW_FRAMES;
+        }
+        gonio->read_pos += n_frames;
+
+        float *mid = gonio->left;
+        float *side = gonio->right;
+        waveform_read(wave, 0, gonio->read_pos, n_frames, mid);
+        waveform_read(wave, 1, gonio->read_pos, n_frames, side);
+
+        // Convert to grid coordinates in place
+        float x_scale = 0.5f * (width - 1);
+        float y_scale = 0.5f * (height - 1);
+        for (unsigned int i = 0; i < n_frames; i++) {
+            float l = mid[i];
+            float r = side[i];
+            mid[i] = (1.0f - (l + r) * 0.5f) * y_scale;
+            side[i] = (1.0f + (l - r) * 0.5f) * x_scale;
+        }
+
+        for (unsigned int i = 0; i < n_frames; i++) {
+            int x = (int)(clamp_to_grid(side[i], width) + 0.5f);
+            int y = (int)(clamp_to_grid(mid[i], height) + 0.5f);
+            density[y * width + x] += 1.0f;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdint.h>
+#include "waveform.h"
+
+/*
+ * Running correlation between the first two channels. The sums decay
+ * exponentially with window_seconds as the time constant, so each block only
+ * adds its own sums on top of the previous ones.
+ */
+struct phase_meter {
+    double window_seconds;  // Length of the correlation window
+    double sum_lr;          // Sum of L * R
+    double sum_ll;          // Sum of L * L
+    double sum_rr;          // Sum of R * R
+    float correlation;      // Latest value in [-1, 1], read by the ui
+};
+
+/*
+ * Goniometer (Lissajous) state, only touched by the ui. Mid/side points read
+ * from the waveform ring are accumulated into a density grid that fades a
+ * little every frame.
+ */
+struct goniometer {
+    unsigned int read_pos;  // Absolute ring position of the last plotted frame
+    float *density;         // One bin per braille dot
+    int width;              // Width of the grid in dots
+    int height;             // Height of the grid in dots
+    float decay;            // How much of the density survives each frame
+
+    float left[WAVE_WINDOW_FRAMES];
+    float right[WAVE_WINDOW_FRAMES];
+};
+
+void phase_meter_process(struct phase_meter *phase, const float *samples, uint32_t n_frames, uint32_t n_channels, uint32_t rate);
+struct goniometer *goniometer_new();
+void goniometer_free(struct goniometer *gonio);
+int goniometer_update(struct goniometer *gonio, const struct waveform *wave, int width, int height);
+
+#endif // PHASE_H
@@ -0,0 +1,165 @@
+/*
+ * Waveform capture and min/max decimation
+ */
+
+#include "waveform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define WAVE_RING_MASK (WAVE_RING_FRAMES - 1)
+
+struct waveform *waveform_new()
+{
+    return calloc(1, sizeof(struct waveform));
+}
+
+void waveform_free(struct waveform *wave)
+{
+    if (wave == NULL) {
+        return;
+    }
+
+    free(wave->column_min);
+    free(wave->column_max);
+    free(wave);
+}
+
+/*
+ * Called from the audio thread with an interleaved block. Channels past
+ * WAVE_MAX_CHANNELS are ignored.
+ */
+void waveform_push(struct waveform *wave, const float *samples, uint32_t n_frames, uint32_t n_channels)
+{
+    uint32_t stored_channels = n_channels < WAVE_MAX_CHANNELS ? n_channels : WAVE_MAX_CHANNELS;
+    unsigned int pos = wave->write_pos;
+
+    // Older frames are overwritten anyway, so only keep the tail of huge blocks
+    if (n_frames > WAVE_RING_FRAMES) {
+        samples += (size_t)(n_frames - WAVE_RING_FRAMES) * n_channels;
+        pos += n_frames - WAVE_RING_FRAMES;
+        n_frames = WAVE_RING_FRAMES;
+    }
+
+    for (uint32_t c = 0; c < stored_channels; c++) {
+        float *ring = wave->ring[c];
+        const float *src = samples + c;
+        for (uint32_t n = 0; n < n_frames; n++) {
+            ring[(pos + n) & WAVE_RING_MASK] = src[(size_t)n * n_channels];
+        }
+    }
+
+    __atomic_store_n(&wave->n_channels, (int)stored_channels, __ATOMIC_RELAXED);
+    __atomic_store_n(&wave->write_pos, pos + n_frames, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copies the n_frames frames of a channel that end at the absolute position
+ * end into out, unwrapping the ring.
+ */
+void waveform_read(const struct waveform *wave, int channel, unsigned int end, unsigned int n_frames, float *out)
+{
+    unsigned int start = (end - n_frames) & WAVE_RING_MASK;
+    unsigned int first = WAVE_RING_FRAMES - start;
+
+    if (first >= n_frames) {
+        memcpy(out, &wave->ring[channel][start], n_frames * sizeof(float));
+    }
+    else {
+        memcpy(out, &wave->ring[channel][start], first * sizeof(float));
+        memcpy(out + first, wave->ring[channel], (n_frames - first) * sizeof(float));
+    }
+}
+
+/*
+ * Finds the minimum and maximum of n >= 1 samples, four at a time when SSE
+ * is available.
+ */
+static void find_min_max(const float *x, int n, float *min_out, float *max_out)
+{
+    int i = 0;
+    float lo = x[0];
+    float hi = x[0];
+
+#if defined(__SSE__)
+    if (n >= 4) {
+        __m128 vmin = _mm_loadu_ps(x);
+        __m128 vmax = vmin;
+
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(x + i);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+        }
+
+        // Reduce the four lanes into one
+        vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+        vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+        lo = _mm_cvtss_f32(vmin);
+        hi = _mm_cvtss_f32(vmax);
+    }
+#endif
+
+    for (; i < n; i++) {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+    }
+
+    *min_out = lo;
+    *max_out = hi;
+}
+
+/*
+ * Reduces the latest WAVE_WINDOW_FRAMES frames of every channel to one
+ * min/max pair per column. The column buffers only grow when the terminal
+ * gets wider, so this doesn't allocate while drawing. Returns the number of
+ * channels decimated.
+ */
+int waveform_decimate(struct waveform *wave, int n_columns)
+{
+    if (n_columns <= 0) {
+        return 0;
+    }
+
+    if (n_columns > wave->column_capacity) {
+        float *column_min = realloc(wave->column_min, (size_t)n_columns * WAVE_MAX_CHANNELS * sizeof(float));
+        float *column_max = realloc(wave->column_max, (size_t)n_columns * WAVE_MAX_CHANNELS * sizeof(float));
+        if (column_min != NULL) {
+            wave->column_min = column_min;
+        }
+        if (column_max != NULL) {
+            wave->column_max = column_max;
+        }
+        if (column_min == NULL || column_max == NULL) {
+            return 0;
+        }
+        wave->column_capacity = n_columns;
+    }
+    wave->n_columns = n_columns;
+
+    int n_channels = __atomic_load_n(&wave->n_channels, __ATOMIC_RELAXED);
+    unsigned int end = __atomic_load_n(&wave->write_pos, __ATOMIC_ACQUIRE);
+
+    for (int c = 0; c < n_channels; c++) {
+        float *column_min = wave->column_min + (size_t)c * n_columns;
+        float *column_max = wave->column_max + (size_t)c * n_columns;
+
+        waveform_read(wave, c, end, WAVE_WINDOW_FRAMES, wave->window);
+
+        for (int i = 0; i < n_columns; i++) {
+            int start = (int)((long long)i * WAVE_WINDOW_FRAMES / n_columns);
+            int stop = (int)((long long)(i + 1) * WAVE_WINDOW_FRAMES / n_columns);
+            if (stop <= start) {
+                stop = start + 1; // More columns than frames
+            }
+            find_min_max(wave->window + start, stop - start, &column_min[i], &column_max[i]);
+        }
+    }
+
+    return n_channels;
+}
@@ -0,0 +1,34 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdint.h>
+
+#define WAVE_MAX_CHANNELS 8
+#define WAVE_RING_FRAMES 16384  // Must be a power of two
+#define WAVE_WINDOW_FRAMES 2048 // Frames spread across the screen (~43ms at 48kHz)
+
+/*
+ * Raw samples shared between the audio thread and the ui. The audio thread
+ * only copies each block into the per channel rings, everything else
+ * (decimation, drawing) happens on the ui side.
+ */
+struct waveform {
+    float ring[WAVE_MAX_CHANNELS][WAVE_RING_FRAMES]; // De-interleaved samples
+    unsigned int write_pos; // Total number of frames written, only the low bits index the ring
+    int n_channels;         // Number of channels in the ring
+
+    // Analysis side, only touched by the ui
+    float window[WAVE_WINDOW_FRAMES];   // Contiguous copy of the latest frames of one channel
+    float *column_min;      // n_columns minimums for every channel
+    float *column_max;      // n_columns maximums for every channel
+    int n_columns;
+    int column_capacity;
+};
+
+struct waveform *waveform_new();
+void waveform_free(struct waveform *wave);
+void waveform_push(struct waveform *wave, const float *samples, uint32_t n_frames, uint32_t n_channels);
+void waveform_read(const struct waveform *wave, int channel, unsigned int end, unsigned int n_frames, float *out);
+int waveform_decimate(struct waveform *wave, int n_columns);
+
+#endif // WAVEFORM_H